@@ -1,15 +1,17 @@
 // var jsh, global, __filename, require, process;
 
-var rl = require('ReadLine');
 var pc = require('ProcessChain');
 var Job = require('Job');
 var Completion = require('Completion');
 var Tokenizer = require('Tokenizer');
+var Prompt = require('Prompt');
+var Output = require('Output');
 var jshnative = require('jsh');
 var path = require('path');
 var fs = require('fs');
 //var Service = require('Service');
 var ifsOverrideStack = [];
+var capturingOutput = 0;
 jsh = {
     get IFS() { return ifsOverrideStack.length ? ifsOverrideStack[ifsOverrideStack.length - 1] : '\n'; },
     path: /^(.*\/)[^/]*$/.exec(__filename)[1],
@@ -44,7 +46,16 @@ jsh = {
         logEnabled: false,
         expandVariables: true,
         prettyReturnValues: 4,
-        printUndefinedReturn: false
+        printUndefinedReturn: false,
+        isolateJavaScript: false,
+        completionTimeout: 2000,
+        // split huge argument lists for the listed commands only, e.g.
+        // { parallel: 1, commands: { rm: {}, cp: { trailing: 1 }, chmod: { leading: 1 } } }
+        batchArguments: undefined,
+        warmServices: false,
+        // false sends everything to the terminal, slowing the job down to its speed.
+        // the last 'keep' spool files are kept until the shell exits
+        outputFlood: { threshold: 8 * 1024 * 1024, tailLines: 8, keep: 4 }
     },
     log: function() {
         if (jsh.config.logEnabled)
@@ -55,25 +66,61 @@ jsh = {
             console.error.apply(console, arguments);
     },
     promptIdx: 0,
-    prompt: function() {
-        if (typeof this._userPrompt === "function") {
-            try {
-                return this._userPrompt();
-            } catch (e) {
-                console.error("prompt error: " + e);
-            }
+    Prompt: Prompt,
+    promptSegments: new Prompt.Prompt(),
+    // segment values are passed to the user prompt, see Prompt.js
+    prompt: function(status) {
+        ++this.promptIdx;
+        try {
+            return this.promptSegments.render(status);
+        } catch (e) {
+            console.error("prompt error: " + e);
         }
-        var p = "jsh(" + (++this.promptIdx) + "): ";
-        return p;
+        return this._defaultPrompt();
+    },
+    _defaultPrompt: function() {
+        return "jsh(" + this.promptIdx + "): ";
+    },
+    _composePrompt: function(segments, ctx) {
+        if (typeof jsh._userPrompt === "function")
+            return jsh._userPrompt(segments, ctx);
+        return jsh._defaultPrompt();
     },
     setPrompt: function(p) {
         this._userPrompt = p;
     },
+    registerPromptSegment: function(name, options) {
+        this.promptSegments.register(name, options);
+    },
     execSync: function(cmd, args) {
         return this.jshNative.execSync(this.pathify(cmd), args);
     }
 };
-jsh.jshNative.setupShell();
+
+// batch input is either a -c command, a script file or a non-tty stdin
+function parseArguments(argv)
+{
+    for (var i = 0; i < argv.length; ++i) {
+        if (argv[i] === "-c") {
+            if (i + 1 >= argv.length) {
+                console.error("jsh: -c requires an argument");
+                process.exit(2);
+            }
+            return { command: argv[i + 1] };
+        } else if (argv[i][0] !== "-") {
+            return { script: argv[i] };
+        }
+    }
+    if (!process.stdin.isTTY)
+        return { stream: process.stdin };
+    return undefined;
+}
+
+jsh.promptSegments.setTemplate(jsh._composePrompt);
+
+var batch = parseArguments(process.argv.slice(2));
+jsh.batch = (batch !== undefined);
+jsh.jshNative.setupShell(!jsh.batch);
 var read;
 var runState;
 
@@ -266,7 +313,10 @@ function runJavaScript(token, job)
     if (job) {
         var jobfunc = eval("(function*() {" + func + "})");
         jsh.log("creating func", func, jobfunc, typeof jobfunc);
-        job.js(new Job.JavaScript(jobfunc));
+        if (jsh.config.isolateJavaScript && token[0].type === Tokenizer.JAVASCRIPT)
+            job.js(new Job.IsolatedJavaScript(jobfunc));
+        else
+            job.js(new Job.JavaScript(jobfunc));
         return undefined;
     } else {
         jsh.log("evaling " + func);
@@ -304,6 +354,46 @@ function jsReturn(ret)
     return !!ret;
 }
 
+// foreground output, spooled to a file instead if it floods the terminal
+function outputSink()
+{
+    function write(arg) { jsh.jshNative.stdout(arg); }
+    // command substitution needs the data, not what the terminal would show
+    if (jsh.batch || !jsh.config.outputFlood || capturingOutput)
+        return { write: write, finish: function() {} };
+    var governor = new Output.Governor(jsh.config.outputFlood, write);
+    return {
+        write: function(arg) { governor.write(arg); },
+        finish: function() {
+            var path = governor.finish();
+            if (path !== undefined)
+                jsh.lastOutput = path;
+        }
+    };
+}
+
+function processEntry(cmd, args)
+{
+    var entry = { program: cmd, arguments: args, environment: jsh.environment(), cwd: process.cwd() };
+    var batch = jsh.config.batchArguments;
+    var name = path.basename(cmd);
+    if (batch && batch.commands && batch.commands.hasOwnProperty(name)) {
+        var command = batch.commands[name];
+        // options and the command's fixed leading and trailing operands are
+        // repeated in every invocation, the operands in between are split up
+        var fixed = 0;
+        while (fixed < args.length && args[fixed][0] === '-' && args[fixed] !== '-') {
+            if (args[fixed++] === '--')
+                break;
+        }
+        fixed += command.leading || 0;
+        var trailing = command.trailing || 0;
+        if (fixed + trailing < args.length)
+            entry.batch = { fixed: fixed, trailing: trailing, parallel: batch.parallel || 1 };
+    }
+    return entry;
+}
+
 function runTokens(tokens, pos)
 {
     if (pos === tokens.length) {
@@ -313,7 +403,7 @@ function runTokens(tokens, pos)
 
     var job, j;
     for (var i = pos; i < tokens.length; ++i) {
-        var token = tokens[i];
+        var token = Tokenizer.expand(tokens[i]);
         var op = operator(token);
         jsh.log("---- " + i + " " + pos + " " + tokens.length);
         op = operator(token);
@@ -372,6 +462,7 @@ function runTokens(tokens, pos)
                 });
                 return;
             }
+            jsh.lastExitCode = jsReturn(ret) ? 0 : 1;
             if (runState.checkOperator(op, jsReturn(ret))) {
                 continue;
             } else {
@@ -393,17 +484,20 @@ function runTokens(tokens, pos)
             jsh.log("execing cmd " + cmd);
             try {
                 if (job) {
-                    job.proc({ program: cmd, arguments: args, environment: jsh.environment(), cwd: process.cwd() });
+                    job.proc(processEntry(cmd, args));
                 } else {
                     var procjob = new Job.Job();
-                    procjob.proc({ program: cmd, arguments: args, environment: jsh.environment(), cwd: process.cwd() });
+                    procjob.proc(processEntry(cmd, args));
+                    var procout = outputSink();
                     procjob.exec(Job.FOREGROUND,
-                                 function(arg) {
-                                     jsh.jshNative.stdout(arg);
-                                 },
+                                 procout.write,
                                  function(code) {
+                                     procout.finish();
+                                     if (procjob.error)
+                                         console.error("jsh: " + procjob.error);
                                      if (procjob.type === Job.BACKGROUND)
                                          return;
+                                     jsh.lastExitCode = code;
                                      if (runState.checkOperator(op, !code)) {
                                          try {
                                              runTokens(tokens, pos + 1, runState);
@@ -425,12 +519,15 @@ function runTokens(tokens, pos)
     }
     if (job) {
         jsh.log("running job");
+        var out = outputSink();
         job.exec(Job.FOREGROUND,
-                 function(arg) {
-                     jsh.jshNative.stdout(arg);
-                 },
+                 out.write,
                  function(code) {
+                     out.finish();
+                     if (job.error)
+                         console.error("jsh: " + job.error);
                      if (job.type === Job.FOREGROUND) {
+                         jsh.lastExitCode = code;
                          runState.update(!code); runState.pop();
                      }
                  });
@@ -465,15 +562,8 @@ function replaceVariables(line, tokens)
 
 function runLine(line)
 {
-    var tokens = [];
-    var tok = new Tokenizer.Tokenizer(Tokenizer.SHELL);
-    tok.tokenize(line);
-    var commands = [];
-    var command;
-    while ((command = tok.next())) {
-        commands.push(command);
-    }
-    runCommands(commands, line);
+    // globs and variables in quotes are expanded right before a statement runs
+    runCommands(Tokenizer.tokenizeLine(line, Tokenizer.SHELL), line);
 }
 
 function runCommands(commands, line)
@@ -489,17 +579,21 @@ function runCommands(commands, line)
             if (command[i].type === Tokenizer.EXECUTE) {
                 if (i == 0 || i + 1 >= command.length)
                     throw "Something wrong, execute not surrounded by `";
+                // only the variables in it, globs around it are expanded when it's run
+                Tokenizer.expand([command[i]]);
                 var oldOut = jsh.jshNative.stdout;
                 var subCommandData = "";
                 jsh.jshNative.stdout = function(data) {
                     subCommandData += data;
                 };
+                ++capturingOutput;
 
                 command[i].type = Tokenizer.COMMAND;
                 // console.log("FISKEFAEN", commands);
                 var continueCommands = true;
                 runState.push(function() {
                     jsh.jshNative.stdout = oldOut;
+                    --capturingOutput;
                     if (continueCommands) {
                         var split = subCommandData.split(/\s+/);
                         if (split[0] === '')
@@ -542,7 +636,7 @@ function runCommands(commands, line)
     var ret;
     if (commands.length === 1 && isFunction(commands[0])) {
         try {
-            ret = runJavaScript(commands[0]);
+            ret = runJavaScript(Tokenizer.expand(commands[0]));
         } catch (e) {
             if (isJSError(e)) {
                 console.log("e3 " + e);
@@ -590,6 +684,7 @@ function runCommands(commands, line)
             }
             jsh.jshNative.stdout(output, "\n");
         }
+        jsh.lastExitCode = jsReturn(ret) ? 0 : 1;
         runState.update(jsReturn(ret));
         runState.pop();
         return;
@@ -653,27 +748,170 @@ runState = new RunState();
 loadRCFile("/etc/jshrc.js");
 loadRCFile(process.env.HOME + "/.jsh/jshrc.js");
 
-// first callback function handles input, the second handles completion
-read = new rl.ReadLine(
-    jsh.prompt(),
-    function(data) {
-        // handle input
-        if (data === undefined) {
-            read.cleanup();
-            Job.cleanup();
-            jsh.jshNative.cleanup();
-            process.exit();
+// scans a (possibly multi-line) chunk of script. complete is false while
+// quotes, braces or parens are still open so that multi-line constructs are
+// run as one line. A # starting a word outside of quotes comments out the
+// rest of its line, text is the chunk with those comments removed.
+function scanLine(line)
+{
+    var depth = 0, quote = undefined, escape = false;
+    var text = "", from = 0;
+    for (var i = 0; i < line.length; ++i) {
+        var ch = line[i];
+        if (escape) {
+            escape = false;
+        } else if (ch === '\\') {
+            escape = true;
+        } else if (quote !== undefined) {
+            if (ch === quote)
+                quote = undefined;
+        } else if (ch === '#' && (i === 0 || /\s/.test(line[i - 1]))) {
+            text += line.substring(from, i);
+            i = line.indexOf('\n', i);
+            if (i === -1)
+                i = line.length;
+            from = i;
+        } else if (ch === '"' || ch === "'" || ch === '`') {
+            quote = ch;
+        } else if (ch === '{' || ch === '(') {
+            ++depth;
+        } else if (ch === '}' || ch === ')') {
+            --depth;
         }
+    }
+    text += line.substr(from);
+    return { complete: !escape && quote === undefined && depth <= 0, text: text };
+}
 
-        try {
-            runState.push(function() { read.resume(jsh.prompt()); });
-            runLine(data, runState);
-        } catch (e) {
-            console.log("e6 " + e);
-            read.resume(jsh.prompt());
+function isCompleteLine(line)
+{
+    return scanLine(line).complete;
+}
+
+// runs lines as soon as they arrive instead of waiting for the whole script
+function runBatch(input)
+{
+    var pending = "", queue = [];
+    var ended = false, running = false, failed = false, code = 0;
+
+    function exit()
+    {
+        Job.cleanup();
+        jsh.jshNative.cleanup();
+        process.exit(code);
+    }
+
+    function runNext()
+    {
+        while (!running && queue.length) {
+            var line = queue.shift();
+            running = true;
+            failed = false;
+            jsh.lastExitCode = undefined;
+            runState.push(function(ret) {
+                // the exit status of the last command, like sh
+                code = (!failed && ret) ? 0 : (jsh.lastExitCode || 1);
+                running = false;
+                setImmediate(runNext);
+            });
+            try {
+                runLine(line);
+            } catch (e) {
+                console.error("jsh: " + e);
+                failed = true;
+                runState.pop();
+            }
         }
-    },
-    function(data) {
-        return jsh.completion.complete(data);
+        if (!running && !queue.length && ended)
+            exit();
+    }
+
+    function queueLine(line)
+    {
+        line = scanLine(line).text.trim();
+        if (line.length)
+            queue.push(line);
+    }
+
+    function addData(data, last)
+    {
+        pending += data;
+        var from = 0, idx;
+        while ((idx = pending.indexOf("\n", from)) !== -1) {
+            var line = pending.substr(0, idx);
+            if (!isCompleteLine(line)) {
+                from = idx + 1;
+                continue;
+            }
+            queueLine(line);
+            pending = pending.substr(idx + 1);
+            from = 0;
+        }
+        if (last) {
+            queueLine(pending);
+            pending = "";
+        }
+        runNext();
+    }
+
+    if (typeof input === "string") {
+        ended = true;
+        addData(input, true);
+        return;
+    }
+    input.setEncoding('utf8');
+    input.on('data', function(data) { addData(data, false); });
+    input.on('end', function() {
+        ended = true;
+        addData("", true);
+    });
+    input.on('error', function(err) {
+        console.error("jsh: " + err.message);
+        code = 1;
+        exit();
+    });
+}
+
+if (batch) {
+    if (batch.command !== undefined) {
+        runBatch(batch.command);
+    } else if (batch.script !== undefined) {
+        runBatch(fs.createReadStream(batch.script));
+    } else {
+        runBatch(batch.stream);
     }
-);
+} else {
+    var rl = require('ReadLine');
+    // first callback function handles input, the second handles completion
+    read = new rl.ReadLine(
+        jsh.prompt(),
+        function(data) {
+            // handle input
+            if (data === undefined) {
+                read.cleanup();
+                Job.cleanup();
+                jsh.jshNative.cleanup();
+                process.exit();
+            }
+
+            try {
+                runState.push(function(status) { read.resume(jsh.prompt(status)); });
+                runLine(data, runState);
+            } catch (e) {
+                console.log("e6 " + e);
+                read.resume(jsh.prompt());
+            }
+        },
+        function(data) {
+            jsh.completion.completeAsync(data, {
+                add: function(cands, options) { return read.completionBatch(data.id, cands, options); },
+                done: function() { read.completionDone(data.id); },
+                get cancelled() { return !read.completionPending(data.id); }
+            });
+        }
+    );
+    read.setCompletionTimeout(jsh.config.completionTimeout);
+    jsh.promptSegments.setRedraw(function(p) { read.redisplay(p); });
+    if (jsh.config.warmServices)
+        require('Service').warm();
+}
@@ -0,0 +1,26 @@
+function match(opt, arg) {
+    var res = new RegExp(opt + "=(.*)").exec(arg);
+    if (res)
+        return res[1];
+    return undefined;
+}
+
+if (typeof process === 'undefined')
+    process.exit(1);
+
+var Supervisor = require('Service/Supervisor');
+
+var servicesDir;
+for (var i=1; i<process.argv.length; ++i) {
+    var res = match("--services-dir", process.argv[i]);
+    if (res) {
+        servicesDir = res;
+        continue;
+    }
+}
+if (!servicesDir) {
+    process.exit(2);
+}
+
+if (!Supervisor.runSupervisor(servicesDir))
+    process.exit(3);
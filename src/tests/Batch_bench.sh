@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Compares jsh batch mode against bash running the same build-like script.
+#
+#   ./Batch_bench.sh [iterations] [steps]
+
+ITERATIONS=${1:-10}
+STEPS=${2:-50}
+
+DIR="$( cd -P "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+JSH="$DIR/../../bin/jsh"
+WORK=`mktemp -d /tmp/jshbench.XXXXXX`
+trap "rm -rf $WORK" EXIT
+
+mkdir -p $WORK/src
+for i in `seq 1 $STEPS`; do
+    printf "int func$i() { return $i; }\n" > $WORK/src/file$i.c
+done
+
+# only plain commands, pipes and && so both shells run it unchanged
+SCRIPT=$WORK/build.jsh
+echo "cd $WORK" > $SCRIPT
+echo "mkdir -p out" >> $SCRIPT
+for i in `seq 1 $STEPS`; do
+    echo "cp src/file$i.c out/file$i.o && grep -c func out/file$i.o" >> $SCRIPT
+done
+echo "ls out | wc -l" >> $SCRIPT
+echo "rm -rf out" >> $SCRIPT
+
+run()
+{
+    local start=`date +%s%N`
+    for i in `seq 1 $ITERATIONS`; do
+        "$@" $SCRIPT > /dev/null || { echo "$1 failed"; exit 1; }
+    done
+    local end=`date +%s%N`
+    echo "$1: $(( (end - start) / 1000000 / ITERATIONS )) ms per run ($STEPS steps)"
+}
+
+run bash
+run $JSH
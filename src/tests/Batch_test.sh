@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Runs scripts through jsh batch mode and compares the output.
+#
+#   ./Batch_test.sh
+
+DIR="$( cd -P "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+JSH="$DIR/../../bin/jsh"
+WORK=`mktemp -d /tmp/jshtest.XXXXXX`
+trap "rm -rf $WORK" EXIT
+FAILED=0
+
+check()
+{
+    local name=$1 expected=$2
+    local actual=`$JSH $WORK/script.jsh 2>&1`
+    if [ "$actual" == "$expected" ]; then
+        echo "PASS $name"
+    else
+        echo "FAIL $name: '$actual' != '$expected'"
+        FAILED=1
+    fi
+}
+
+cat > $WORK/script.jsh <<'SCRIPT'
+# a script comment
+echo one # trailing comment
+echo "two # quoted"
+echo three\#escaped
+SCRIPT
+check "trailing comment" "one
+two # quoted
+three#escaped"
+
+cat > $WORK/script.jsh <<'SCRIPT'
+if (true) { # opens the block
+    # inside the block
+    console.log("four");
+}
+SCRIPT
+check "comment in block" "four"
+
+if [ $FAILED -ne 0 ]; then
+    echo "FAILED"
+    exit 1
+fi
+echo "PASSED"
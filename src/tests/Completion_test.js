@@ -0,0 +1,48 @@
+// Completion of absolute paths with several matches, the substitution text
+// is the completer's first entry and not the common prefix of the shortened
+// display entries.
+//
+//   node --harmony Completion_test.js
+
+var fs = require('fs');
+var os = require('os');
+
+jsh = {
+    config: {},
+    log: function() {},
+    pathify: function(prog) { return prog; }
+};
+
+var Completion = require('Completion');
+var completion = new Completion.Completion();
+
+var dir = fs.mkdtempSync(os.tmpdir() + "/jsh-completion-");
+fs.mkdirSync(dir + "/lib");
+fs.mkdirSync(dir + "/local");
+fs.writeFileSync(dir + "/other", "");
+
+var failed = 0;
+function check(name, comp, expected, cb)
+{
+    var text = "ls " + comp;
+    completion.complete({ text: text, comp: comp, start: 3, end: text.length }, function(result) {
+        var ok = JSON.stringify(result) === JSON.stringify(expected);
+        if (!ok)
+            ++failed;
+        console.log((ok ? "PASS " : "FAIL ") + name + (ok ? "" : ": " + JSON.stringify(result) + " != " + JSON.stringify(expected)));
+        cb();
+    });
+}
+
+check("several matches", dir + "/l", [ dir + "/l", "lib/", "local/" ], function() {
+    check("common prefix", dir + "/lo", [ dir + "/local/" ], function() {
+        check("directory", dir + "/", [ dir + "/", "lib/", "local/", "other" ], function() {
+            fs.rmdirSync(dir + "/lib");
+            fs.rmdirSync(dir + "/local");
+            fs.unlinkSync(dir + "/other");
+            fs.rmdirSync(dir);
+            console.log(failed ? "FAILED" : "PASSED");
+            process.exit(failed ? 1 : 0);
+        });
+    });
+});
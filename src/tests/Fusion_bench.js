@@ -0,0 +1,68 @@
+// Per-record cost of chains of JavaScript stages, fused into one entry
+// versus run one by one with the records joined and split on the IFS
+// between every stage.
+//
+//   node --harmony Fusion_bench.js [records] [maxStages]
+
+var Job = require('Job');
+
+jsh = {
+    get IFS() { return '\n'; },
+    pathify: function(prog) { return prog; }
+};
+
+var records = parseInt(process.argv[2]) || 200000;
+var maxStages = parseInt(process.argv[3]) || 8;
+
+function* producer()
+{
+    yield undefined;
+    for (var i = 0; i < records; ++i)
+        yield "record number " + i;
+}
+
+function* passthrough()
+{
+    var data = yield undefined;
+    while (data !== undefined)
+        data = yield data;
+}
+
+function run(stages, fuse, cb)
+{
+    var job = new Job.Job();
+    job.fuse = fuse;
+    job.js(new Job.JavaScript(producer));
+    for (var i = 0; i < stages; ++i)
+        job.js(new Job.JavaScript(passthrough));
+    var count = 0;
+    var start = process.hrtime();
+    job.exec(Job.BACKGROUND, function(data) {
+        count += data.split('\n').length - 1;
+    }, function() {
+        var diff = process.hrtime(start);
+        if (count !== records)
+            throw "Expected " + records + " records, got " + count;
+        cb((diff[0] * 1e9 + diff[1]) / records);
+    });
+}
+
+var results = [];
+function next(stages)
+{
+    if (stages > maxStages) {
+        console.log("stages   fused ns/record   separate ns/record");
+        results.forEach(function(r) {
+            console.log(("      " + r.stages).slice(-6) + ("                 " + r.fused.toFixed(0)).slice(-16)
+                        + ("                    " + r.separate.toFixed(0)).slice(-21));
+        });
+        return;
+    }
+    run(stages, true, function(fused) {
+        run(stages, false, function(separate) {
+            results.push({ stages: stages, fused: fused, separate: separate });
+            next(stages + 1);
+        });
+    });
+}
+next(0);
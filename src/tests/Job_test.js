@@ -1,7 +1,9 @@
 var Job = require('Job');
 var jshNative = require('jsh');
 jsh = {
-    jshNative: new jshNative.jsh()
+    get IFS() { return "\n"; },
+    jshNative: new jshNative.jsh(),
+    pathify: function(prog) { return prog; }
 };
 
 var job1 = new Job.Job();
@@ -16,3 +18,8 @@ var js4 = new Job.JavaScript(function(data) { return data + " fofo"; });
 var js5 = new Job.JavaScript(function(data) { return data + " final"; });
 var job2 = new Job.Job();
 job2.js(js3).js(js4).proc({ program: "/bin/grep", arguments: [ "hello" ]}).js(js5).exec(0, function(data) { console.log("hey 2 " + data); });
+
+function* upper() { var data = yield undefined; while (data !== undefined) data = yield data.toUpperCase(); }
+function* count() { var n = 0; while ((yield undefined) !== undefined) ++n; return n + " " + suffix; }
+var job3 = new Job.Job();
+job3.proc({ program: "/bin/ls", arguments: [ "/bin" ] }).js(new Job.IsolatedJavaScript(upper)).js(new Job.IsolatedJavaScript(count, { suffix: "lines" })).exec(0, function(data) { console.log("hey 3 " + data); });
@@ -0,0 +1,227 @@
+// Long running load test, drives a mix of process, JavaScript and mixed
+// pipelines through Job and fails if fds, memory or allJobs keep growing.
+//
+//   node --harmony --expose-gc Soak_test.js --duration=3600 --concurrency=16 --mix=process:2,js:1,mixed:1
+//
+// Options:
+//   --duration=<seconds>      how long to run (default 60)
+//   --concurrency=<n>         number of jobs in flight (default 8)
+//   --mix=<type:weight,...>   relative weights of process, js, mixed and disowned pipelines
+//   --interval=<seconds>      seconds between samples (default 5)
+//   --warmup=<fraction>       fraction of the samples to ignore before checking growth (default 0.2)
+//   --fd-slack=<n>            open fds allowed above the baseline (default 4)
+//   --growth=<ratio>          allowed rss/heap growth between the first and last window (default 0.25)
+
+var fs = require('fs');
+var Job = require('Job');
+var jshNative = require('jsh');
+
+jsh = {
+    get IFS() { return '\n'; },
+    jshNative: new jshNative.jsh(),
+    pathify: function(prog) { return prog; }
+};
+jsh.jshNative.setupShell();
+
+function match(opt, arg) {
+    var res = new RegExp(opt + "=(.*)").exec(arg);
+    if (res)
+        return res[1];
+    return undefined;
+}
+
+var options = {
+    duration: 60,
+    concurrency: 8,
+    mix: "process:1,js:1,mixed:1,disowned:1",
+    interval: 5,
+    warmup: 0.2,
+    fdSlack: 4,
+    growth: 0.25
+};
+
+var optionNames = { duration: "--duration", concurrency: "--concurrency", mix: "--mix", interval: "--interval",
+                    warmup: "--warmup", fdSlack: "--fd-slack", growth: "--growth" };
+for (var i = 2; i < process.argv.length; ++i) {
+    for (var name in optionNames) {
+        var res = match(optionNames[name], process.argv[i]);
+        if (res !== undefined)
+            options[name] = (name === "mix") ? res : parseFloat(res);
+    }
+}
+
+function* producer()
+{
+    yield undefined;
+    for (var i = 0; i < 16; ++i)
+        yield "js line " + i;
+}
+
+function* filter()
+{
+    var data = yield undefined;
+    while (data !== undefined)
+        data = yield data.toUpperCase();
+}
+
+var pipelines = {
+    process: function() {
+        return new Job.Job().proc({ program: "/bin/echo", arguments: [ "hello from echo" ] })
+                            .proc({ program: "/bin/cat" });
+    },
+    js: function() {
+        return new Job.Job().js(new Job.JavaScript(producer)).js(new Job.JavaScript(filter));
+    },
+    mixed: function() {
+        return new Job.Job().proc({ program: "/bin/ls", arguments: [ "/" ] })
+                            .js(new Job.JavaScript(filter))
+                            .proc({ program: "/bin/cat" });
+    },
+    // disowned right after it starts, it still has to finish cleanly
+    disowned: function() {
+        var job = new Job.Job().proc({ program: "/bin/echo", arguments: [ "disowned" ] })
+                               .proc({ program: "/bin/cat" });
+        job.disownOnStart = true;
+        return job;
+    }
+};
+
+var weighted = [];
+options.mix.split(',').forEach(function(entry) {
+    var parts = entry.split(':');
+    if (!pipelines.hasOwnProperty(parts[0]))
+        throw "Unknown pipeline type " + parts[0];
+    var weight = parts.length > 1 ? parseInt(parts[1]) : 1;
+    for (var w = 0; w < weight; ++w)
+        weighted.push(parts[0]);
+});
+if (!weighted.length)
+    throw "Empty pipeline mix";
+
+var started = Date.now();
+var stopping = false;
+var inFlight = 0;
+var completed = 0, completedAtLastSample = 0;
+var latencies = [];
+var samples = [];
+var counter = 0;
+
+function openFds()
+{
+    return fs.readdirSync("/proc/self/fd").length;
+}
+
+function sample()
+{
+    if (typeof global.gc === "function")
+        global.gc();
+    var mem = process.memoryUsage();
+    return { fds: openFds(), rss: mem.rss, heap: mem.heapUsed, jobs: Job.Jobs.length };
+}
+
+function percentile(sorted, p)
+{
+    if (!sorted.length)
+        return 0;
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+function report()
+{
+    var s = sample();
+    samples.push(s);
+
+    var sorted = latencies.sort(function(a, b) { return a - b; });
+    latencies = [];
+    var rate = (completed - completedAtLastSample) / options.interval;
+    completedAtLastSample = completed;
+
+    console.log("[" + Math.round((Date.now() - started) / 1000) + "s] "
+                + rate.toFixed(1) + " cmds/s"
+                + "  p50 " + percentile(sorted, 0.5).toFixed(2) + "ms"
+                + "  p90 " + percentile(sorted, 0.9).toFixed(2) + "ms"
+                + "  p99 " + percentile(sorted, 0.99).toFixed(2) + "ms"
+                + "  fds " + s.fds
+                + "  rss " + (s.rss / 1048576).toFixed(1) + "M"
+                + "  heap " + (s.heap / 1048576).toFixed(1) + "M"
+                + "  jobs " + s.jobs);
+}
+
+function windowMax(list, key)
+{
+    var max = 0;
+    for (var i = 0; i < list.length; ++i)
+        max = Math.max(max, list[i][key]);
+    return max;
+}
+
+function verify()
+{
+    var errors = [];
+    var first = Math.floor(samples.length * options.warmup);
+    var steady = samples.slice(first);
+    if (steady.length < 4) {
+        console.log("Not enough samples to verify growth, increase --duration");
+        return errors;
+    }
+    var win = Math.max(1, Math.floor(steady.length / 4));
+    var head = steady.slice(0, win), tail = steady.slice(steady.length - win);
+
+    if (windowMax(tail, "fds") > windowMax(head, "fds") + options.fdSlack)
+        errors.push("open fds grew from " + windowMax(head, "fds") + " to " + windowMax(tail, "fds"));
+    if (windowMax(tail, "jobs") > options.concurrency)
+        errors.push("allJobs holds " + windowMax(tail, "jobs") + " entries with " + options.concurrency + " in flight");
+    ["rss", "heap"].forEach(function(key) {
+        var from = windowMax(head, key), to = windowMax(tail, key);
+        if (to > from * (1 + options.growth))
+            errors.push(key + " grew from " + (from / 1048576).toFixed(1) + "M to " + (to / 1048576).toFixed(1) + "M");
+    });
+    return errors;
+}
+
+function finish()
+{
+    report();
+    var errors = verify();
+    for (var i = 0; i < errors.length; ++i)
+        console.error("LEAK: " + errors[i]);
+    console.log(errors.length ? "FAILED" : "PASSED", completed, "pipelines");
+    process.exit(errors.length ? 1 : 0);
+}
+
+function launch()
+{
+    if (stopping)
+        return;
+    var type = weighted[counter++ % weighted.length];
+    var job = pipelines[type]();
+    var start = process.hrtime();
+    ++inFlight;
+    job.exec(Job.BACKGROUND, function() {}, function() {
+        var diff = process.hrtime(start);
+        latencies.push(diff[0] * 1e3 + diff[1] / 1e6);
+        ++completed;
+        --inFlight;
+        if (stopping) {
+            if (!inFlight)
+                finish();
+        } else {
+            setImmediate(launch);
+        }
+    });
+    if (job.disownOnStart && Job.Jobs.indexOf(job) !== -1)
+        job.disown();
+}
+
+samples.push(sample());
+console.log("soak: " + JSON.stringify(options));
+var reporter = setInterval(report, options.interval * 1000);
+setTimeout(function() {
+    stopping = true;
+    clearInterval(reporter);
+    if (!inFlight)
+        finish();
+}, options.duration * 1000);
+
+for (var c = 0; c < options.concurrency; ++c)
+    launch();
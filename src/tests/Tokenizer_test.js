@@ -0,0 +1,82 @@
+// Tokenizing with globs and variables deferred to expand() gives the same
+// statements as the eager tokenizer, and lines lexed from a cached
+// checkpoint match a full re-lex.
+//
+//   node --harmony Tokenizer_test.js
+
+var fs = require('fs');
+var os = require('os');
+
+jsh = {
+    config: { expandVariables: true },
+    log: function() {}
+};
+
+var Tokenizer = require('Tokenizer');
+
+var dir = fs.mkdtempSync(os.tmpdir() + "/jsh-tokenizer-");
+fs.writeFileSync(dir + "/a.js", "");
+fs.writeFileSync(dir + "/b.js", "");
+process.chdir(dir);
+FOO = "bar";
+
+function lex(line, flags)
+{
+    var tok = new Tokenizer.Tokenizer(flags), entry, entries = [];
+    tok.tokenize(line);
+    while ((entry = tok.next()))
+        entries.push(entry);
+    return entries;
+}
+
+function strip(entries)
+{
+    return JSON.stringify(entries.map(function(entry) {
+        return entry.map(function(token) { return [ token.type, token.data ]; });
+    }));
+}
+
+var failed = 0;
+function check(name, actual, expected)
+{
+    var ok = actual === expected;
+    if (!ok)
+        ++failed;
+    console.log((ok ? "PASS " : "FAIL ") + name + (ok ? "" : ": " + actual + " != " + expected));
+}
+
+var lines = [
+    "ls *.js",
+    "echo nomatch*",
+    "echo *$FOO",
+    "echo zz*`echo x`",
+    "echo *.js`echo x` | wc -l",
+    "echo \"hi $FOO there\"; ls -l | grep x && echo { 1+2 }",
+    "echo \\* \"a\\\"b\" ~/x"
+];
+lines.forEach(function(line) {
+    var deferred;
+    try {
+        deferred = strip(Tokenizer.tokenizeLine(line, Tokenizer.SHELL).map(function(entry) {
+            return Tokenizer.expand(entry);
+        }));
+    } catch (e) {
+        deferred = "threw " + e;
+    }
+    check("deferred '" + line + "'", deferred, strip(lex(line, Tokenizer.SHELL)));
+});
+
+var base = "echo foo; ls -l | grep x; ";
+Tokenizer.tokenizeLine(base + "echo one", Tokenizer.SHELL);
+[ "echo two", "echo *.js", "echo \"$FOO\"", "ls `pwd`" ].forEach(function(rest) {
+    var line = base + rest;
+    var cached = Tokenizer.tokenizeLine(line, Tokenizer.SHELL);
+    check("cached '" + line + "'", strip(cached), strip(lex(line, Tokenizer.SHELL | Tokenizer.DEFER)));
+});
+
+fs.unlinkSync(dir + "/a.js");
+fs.unlinkSync(dir + "/b.js");
+process.chdir(os.tmpdir());
+fs.rmdirSync(dir);
+console.log(failed ? "FAILED" : "PASSED");
+process.exit(failed ? 1 : 0);